@@ -0,0 +1,343 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include "common.h"
+#include "shmRing.h"
+
+#define BUFFER_SIZE 1024
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    int idx = (int)(p * n + 0.999999) - 1;
+    if (idx < 0) idx = 0;
+    if (idx >= n) idx = n - 1;
+    return sorted[idx];
+}
+
+static void report(const char *mode, double *samples, int n, double elapsed_us) {
+    qsort(samples, n, sizeof(double), cmp_double);
+    printf("%s: %d sessions in %.3f s (%.0f sessions/s)\n",
+           mode, n, elapsed_us / 1e6, n / (elapsed_us / 1e6));
+    printf("  p50 %.1f us  p99 %.1f us  p99.9 %.1f us  max %.1f us\n",
+           percentile(samples, n, 0.50), percentile(samples, n, 0.99),
+           percentile(samples, n, 0.999), samples[n - 1]);
+}
+
+// Answer a server-issued binary task in place.
+static void solve_task(struct calcProtocol *task) {
+    uint32_t arith = ntohl(task->arith);
+    int err;
+    if (arith >= 1 && arith <= 4)
+        task->inResult = htonl(do_int_op(arith, ntohl(task->inValue1),
+                                         ntohl(task->inValue2), &err));
+    else
+        task->flResult = do_float_op(arith, task->flValue1, task->flValue2, &err);
+}
+
+static void fill_request(struct calcProtocol *msg, int i) {
+    memset(msg, 0, sizeof(*msg));
+    msg->type = htons(1);
+    msg->major_version = htons(1);
+    msg->minor_version = htons(1);
+    msg->id = htonl(i);
+    msg->arith = htonl((i % 4) + 1);
+    msg->inValue1 = htonl(i % 100 + 1);
+    msg->inValue2 = htonl(i % 99 + 1);
+}
+
+static int connect_udp(const char *host, const char *port) {
+    struct addrinfo hints, *res, *rp;
+    int sockfd = -1;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+        return -1;
+    }
+    for (rp = res; rp != NULL; rp = rp->ai_next) {
+        sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+        if (sockfd == -1) continue;
+        if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) == 0) break;
+        close(sockfd);
+    }
+    freeaddrinfo(res);
+    if (rp == NULL) return -1;
+    struct timeval tv = { 1, 0 };
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return sockfd;
+}
+
+static int open_udp(const char *host, const char *port, int busy_usec) {
+    int sockfd = connect_udp(host, port);
+    if (sockfd < 0) {
+        perror("Failed to set up UDP socket");
+        return -1;
+    }
+    enable_busy_poll(sockfd, busy_usec);
+    return sockfd;
+}
+
+// One binary UDP session: hello, task, answer, verdict. The server keys
+// sessions on the client address, so after any failure the next session
+// starts from a fresh socket rather than reading a stale late reply.
+static int bench_udp(const char *host, const char *port, int count, int busy_usec) {
+    int sockfd = open_udp(host, port, busy_usec);
+    if (sockfd < 0) return -1;
+    double *samples = malloc(count * sizeof(double));
+    if (!samples) {
+        close(sockfd);
+        return -1;
+    }
+    int done = 0, failed = 0;
+    double start = now_us();
+    for (int i = 0; i < count; i++) {
+        struct calcProtocol msg;
+        char buf[BUFFER_SIZE];
+        const char *fail = NULL;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = htons(CALC_MSG_HELLO);
+        msg.major_version = htons(1);
+        msg.minor_version = htons(0);
+        double t0 = now_us();
+        send(sockfd, &msg, sizeof(msg), 0);
+        if (recv(sockfd, &msg, sizeof(msg), 0) != sizeof(msg)) {
+            fail = "no task received";
+        } else {
+            solve_task(&msg);
+            send(sockfd, &msg, sizeof(msg), 0);
+            ssize_t n = recv(sockfd, buf, sizeof(buf) - 1, 0);
+            if (n <= 0) {
+                fail = "no result received";
+            } else {
+                buf[n] = '\0';
+                if (strncmp(buf, "RESULT: correct", 15) != 0)
+                    fail = "answer not accepted";
+            }
+        }
+        if (fail) {
+            fprintf(stderr, "session %d: %s\n", i, fail);
+            failed++;
+            close(sockfd);
+            sockfd = open_udp(host, port, busy_usec);
+            if (sockfd < 0) break;
+            continue;
+        }
+        samples[done++] = now_us() - t0;
+    }
+    double elapsed = now_us() - start;
+    if (done > 0) report("udp", samples, done, elapsed);
+    if (failed > 0) fprintf(stderr, "udp: %d sessions failed\n", failed);
+    free(samples);
+    if (sockfd >= 0) close(sockfd);
+    return done > 0 ? 0 : -1;
+}
+
+// One binary TCP session per connection: request frame, computed reply.
+// With fastopen the frame rides on the SYN via MSG_FASTOPEN.
+static int bench_tcp(const char *host, const char *port, int count, int fastopen) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(err));
+        return -1;
+    }
+#ifndef MSG_FASTOPEN
+    if (fastopen) {
+        fprintf(stderr, "MSG_FASTOPEN not supported on this platform\n");
+        fastopen = 0;
+    }
+#endif
+    double *samples = malloc(count * sizeof(double));
+    if (!samples) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    int done = 0, failed = 0;
+    double start = now_us();
+    for (int i = 0; i < count; i++) {
+        struct calcProtocol msg;
+        fill_request(&msg, i);
+        double t0 = now_us();
+        int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (fd < 0) {
+            perror("socket");
+            break;
+        }
+        ssize_t n;
+#ifdef MSG_FASTOPEN
+        if (fastopen) {
+            n = sendto(fd, &msg, sizeof(msg), MSG_FASTOPEN, res->ai_addr, res->ai_addrlen);
+        } else
+#endif
+        {
+            if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+                perror("connect");
+                close(fd);
+                failed++;
+                continue;
+            }
+            n = send(fd, &msg, sizeof(msg), 0);
+        }
+        if (n != sizeof(msg)) {
+            fprintf(stderr, "session %d: send failed\n", i);
+            close(fd);
+            failed++;
+            continue;
+        }
+        size_t got = 0;
+        while (got < sizeof(msg)) {
+            n = recv(fd, (char *)&msg + got, sizeof(msg) - got, 0);
+            if (n <= 0) break;
+            got += n;
+        }
+        close(fd);
+        if (got != sizeof(msg)) {
+            fprintf(stderr, "session %d: short reply\n", i);
+            failed++;
+            continue;
+        }
+        if (ntohs(msg.type) != 1 || ntohl(msg.id) != (uint32_t)i) {
+            fprintf(stderr, "session %d: unexpected reply type %u id %u\n",
+                    i, ntohs(msg.type), ntohl(msg.id));
+            failed++;
+            continue;
+        }
+        samples[done++] = now_us() - t0;
+    }
+    double elapsed = now_us() - start;
+    if (done > 0) report(fastopen ? "tcp+tfo" : "tcp", samples, done, elapsed);
+    if (failed > 0) fprintf(stderr, "tcp: %d sessions failed\n", failed);
+    free(samples);
+    freeaddrinfo(res);
+    return done > 0 ? 0 : -1;
+}
+
+// Request/response round trips over a shared-memory ring pair.
+static int bench_shm(const char *path, int count, int spin_max) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long.\n");
+        return -1;
+    }
+    shm_endpoint_t ep;
+    memset(&ep, 0, sizeof(ep));
+    ep.spin_max = spin_max;
+    ep.sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (ep.sock < 0 || connect(ep.sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        if (ep.sock >= 0) close(ep.sock);
+        return -1;
+    }
+    if (shm_channel_attach(&ep) < 0) {
+        close(ep.sock);
+        return -1;
+    }
+    double *samples = malloc(count * sizeof(double));
+    if (!samples) {
+        shm_channel_close(&ep);
+        close(ep.sock);
+        return -1;
+    }
+    int done = 0, failed = 0;
+    double start = now_us();
+    for (int i = 0; i < count; i++) {
+        struct calcProtocol msg;
+        fill_request(&msg, i);
+        double t0 = now_us();
+        if (shm_ring_push(&ep.ch->req, ep.req_efd, &msg) < 0 ||
+            shm_ring_pop(&ep, &ep.ch->resp, ep.resp_efd, &msg) < 0) {
+            fprintf(stderr, "session %d: server went away\n", i);
+            failed += count - i;
+            break;
+        }
+        if (ntohs(msg.type) != 1 || ntohl(msg.id) != (uint32_t)i) {
+            fprintf(stderr, "session %d: unexpected reply type %u id %u\n",
+                    i, ntohs(msg.type), ntohl(msg.id));
+            failed++;
+            continue;
+        }
+        samples[done++] = now_us() - t0;
+    }
+    double elapsed = now_us() - start;
+    if (done > 0) report("shm", samples, done, elapsed);
+    if (failed > 0) fprintf(stderr, "shm: %d sessions failed\n", failed);
+    free(samples);
+    shm_channel_close(&ep);
+    close(ep.sock);
+    return done > 0 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c cpu] [-b busy_poll_usec] [-f] [-s max_spin] [-n sessions]\n"
+                    "       udp|tcp <host:port> | shm <socket path>\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int cpu = -1, busy_usec = 0, count = 10000, fastopen = 0, spin_max = SHM_SPIN_MAX, opt;
+    while ((opt = getopt(argc, argv, "c:b:fs:n:")) != -1) {
+        switch (opt) {
+            case 'c':
+                if (parse_cpu_list(optarg, &cpu, 1) != 1) {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b': busy_usec = atoi(optarg); break;
+            case 'f': fastopen = 1; break;
+            case 's': spin_max = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || count <= 0) usage(argv[0]);
+    const char *mode = argv[optind];
+    const char *target = argv[optind + 1];
+    spin_max = shm_spin_limit(spin_max);
+    if (cpu >= 0 && pin_to_cpu(cpu) < 0) return EXIT_FAILURE;
+    if (strcmp(mode, "shm") == 0)
+        return bench_shm(target, count, spin_max) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    const char *colon = strrchr(target, ':');
+    if (!colon) usage(argv[0]);
+    char host[256];
+    size_t hlen = colon - target;
+    if (hlen >= sizeof(host)) usage(argv[0]);
+    memcpy(host, target, hlen);
+    host[hlen] = '\0';
+    int rv = -1;
+    if (strcmp(mode, "udp") == 0)
+        rv = bench_udp(host, colon + 1, count, busy_usec);
+    else if (strcmp(mode, "tcp") == 0)
+        rv = bench_tcp(host, colon + 1, count, fastopen);
+    else
+        usage(argv[0]);
+    return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
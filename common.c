@@ -1,5 +1,12 @@
+#define _GNU_SOURCE
 #include "common.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <arpa/inet.h>
 
 int generate_task(Task *task) {
     char ops[] = {'+', '-', '*', '/'};
@@ -22,3 +29,130 @@ int calculate_task(const Task *task) {
     }
     return 0; // fallback
 }
+
+int32_t do_int_op(uint32_t arith, int32_t v1, int32_t v2, int *err) {
+    *err = 0;
+    switch (arith) {
+        case 1: return v1 + v2;
+        case 2: return v1 - v2;
+        case 3: return v1 * v2;
+        case 4:
+            if (v2 == 0) { *err = 1; return 0; }
+            return v1 / v2;
+        default: *err = 1; return 0;
+    }
+}
+
+double do_float_op(uint32_t arith, double v1, double v2, int *err) {
+    *err = 0;
+    switch (arith) {
+        case 5: return v1 + v2;
+        case 6: return v1 - v2;
+        case 7: return v1 * v2;
+        case 8:
+            if (v2 == 0.0) { *err = 1; return 0.0; }
+            return v1 / v2;
+        default: *err = 1; return 0.0;
+    }
+}
+
+int evaluate_frame(const struct calcProtocol *frame, struct calcProtocol *resp) {
+    struct calcProtocol req = *frame;
+    req.type = ntohs(req.type);
+    req.major_version = ntohs(req.major_version);
+    req.minor_version = ntohs(req.minor_version);
+    req.id = ntohl(req.id);
+    req.arith = ntohl(req.arith);
+    req.inValue1 = ntohl(req.inValue1);
+    req.inValue2 = ntohl(req.inValue2);
+    req.inResult = ntohl(req.inResult);
+    memset(resp, 0, sizeof(*resp));
+    resp->type = htons(1);
+    resp->major_version = htons(1);
+    resp->minor_version = htons(1);
+    resp->id = htonl(req.id);
+    resp->arith = htonl(req.arith);
+    resp->inValue1 = htonl(req.inValue1);
+    resp->inValue2 = htonl(req.inValue2);
+    int err = 0;
+    if (req.arith >= 1 && req.arith <= 4) {
+        int32_t result = do_int_op(req.arith, req.inValue1, req.inValue2, &err);
+        resp->inResult = htonl(result);
+        resp->flResult = 0.0;
+    } else if (req.arith >= 5 && req.arith <= 8) {
+        double result = do_float_op(req.arith, req.flValue1, req.flValue2, &err);
+        resp->inResult = 0;
+        resp->flResult = result;
+    } else {
+        err = 1;
+    }
+    return err ? -1 : 0;
+}
+
+int pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    return 0;
+}
+
+int parse_cpu_list(const char *list, int *cpus, int max) {
+    int count = 0;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10), hi = lo;
+        if (end == p || lo < 0) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        for (long cpu = lo; cpu <= hi; cpu++) {
+            if (count == max) return -1;
+            cpus[count++] = (int)cpu;
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return count > 0 ? count : -1;
+}
+
+int enable_busy_poll(int sockfd, int usec) {
+    if (usec <= 0) return 0;
+#ifdef SO_BUSY_POLL
+    if (setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+        perror("setsockopt SO_BUSY_POLL");
+        return -1;
+    }
+    return 0;
+#else
+    (void)sockfd;
+    fprintf(stderr, "SO_BUSY_POLL not supported on this platform\n");
+    return -1;
+#endif
+}
+
+ssize_t spin_recvfrom(int sockfd, void *buf, size_t len,
+                      struct sockaddr *addr, socklen_t *addr_len, int usec) {
+    struct timespec start, now;
+    socklen_t cap = *addr_len;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        *addr_len = cap;
+        ssize_t n = recvfrom(sockfd, buf, len, MSG_DONTWAIT, addr, addr_len);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return n;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (now.tv_sec - start.tv_sec) * 1000000L +
+                       (now.tv_nsec - start.tv_nsec) / 1000;
+        if (elapsed >= usec) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+}
@@ -1,9 +1,13 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stdint.h>
 #include <sys/socket.h>
 
 #define MAX_BUFFER_SIZE 1024
+#define MAX_CPUS 256
+// calcProtocol type a client uses to open a binary session.
+#define CALC_MSG_HELLO 22
 
 typedef struct {
     int operand1;
@@ -11,7 +15,40 @@ typedef struct {
     char operator; // '+', '-', '*', '/'
 } Task;
 
+struct __attribute__((__packed__)) calcProtocol {
+    uint16_t type;
+    uint16_t major_version;
+    uint16_t minor_version;
+    uint32_t id;
+    uint32_t arith;
+    int32_t inValue1;
+    int32_t inValue2;
+    int32_t inResult;
+    double flValue1;
+    double flValue2;
+    double flResult;
+};
+
 int generate_task(Task *task);
 int calculate_task(const Task *task);
 
+int32_t do_int_op(uint32_t arith, int32_t v1, int32_t v2, int *err);
+double do_float_op(uint32_t arith, double v1, double v2, int *err);
+// Answer a binary request frame (network byte order) into resp.
+// Returns -1 for an unknown operation or division by zero.
+int evaluate_frame(const struct calcProtocol *req, struct calcProtocol *resp);
+
+// Pin the calling process to one CPU. Memory first touched afterwards is
+// placed on that CPU's NUMA node by the kernel's default policy.
+int pin_to_cpu(int cpu);
+// Parse a CPU list such as "2,3,4" or "2-4,8" into cpus.
+// Returns the number of entries, or -1 if malformed or longer than max.
+int parse_cpu_list(const char *list, int *cpus, int max);
+// Set SO_BUSY_POLL on a socket; usec <= 0 leaves it untouched.
+int enable_busy_poll(int sockfd, int usec);
+// Spin on a non-blocking recvfrom for up to usec microseconds.
+// Returns -1 with errno EAGAIN if nothing arrived in that window.
+ssize_t spin_recvfrom(int sockfd, void *buf, size_t len,
+                      struct sockaddr *addr, socklen_t *addr_len, int usec);
+
 #endif // COMMON_H
\ No newline at end of file
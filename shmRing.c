@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include "shmRing.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() atomic_signal_fence(memory_order_seq_cst)
+#endif
+
+static int send_fds(int sock, const int *fds, int nfds) {
+    char byte = 0;
+    struct iovec iov = { &byte, 1 };
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(&u, 0, sizeof(u));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    return sendmsg(sock, &msg, 0) == 1 ? 0 : -1;
+}
+
+static int recv_fds(int sock, int *fds, int nfds) {
+    char byte;
+    struct iovec iov = { &byte, 1 };
+    union {
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } u;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        return -1;
+    int got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (got > nfds) got = nfds;
+    memcpy(fds, CMSG_DATA(cmsg), got * sizeof(int));
+    if (got != nfds || (msg.msg_flags & MSG_CTRUNC)) {
+        for (int i = 0; i < got; i++) close(fds[i]);
+        return -1;
+    }
+    return 0;
+}
+
+int shm_spin_limit(int requested) {
+    cpu_set_t set;
+    if (sysconf(_SC_NPROCESSORS_ONLN) <= 1 ||
+        (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) <= 1))
+        return SHM_SPIN_MIN;
+    return requested;
+}
+
+_Atomic int *shm_core_counters(int n) {
+    _Atomic int *counters = mmap(NULL, n * sizeof(_Atomic int), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counters == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    return counters;
+}
+
+// The CPU pid is confined to, or -1 if its mask allows more than one.
+static int pinned_cpu(pid_t pid) {
+    cpu_set_t set;
+    if (sched_getaffinity(pid, sizeof(set), &set) < 0 || CPU_COUNT(&set) != 1)
+        return -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set)) return cpu;
+    return -1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void init_endpoint(shm_endpoint_t *ep) {
+    ep->req_efd = ep->resp_efd = -1;
+    if (ep->spin_max < SHM_SPIN_MIN) ep->spin_max = SHM_SPIN_MIN;
+    ep->spin = SHM_SPIN_MIN;
+}
+
+int shm_channel_create(shm_endpoint_t *ep) {
+    init_endpoint(ep);
+    int memfd = memfd_create("calc-shm", MFD_CLOEXEC);
+    if (memfd < 0) {
+        perror("memfd_create");
+        return -1;
+    }
+    if (ftruncate(memfd, sizeof(struct shm_channel)) < 0) {
+        perror("ftruncate");
+        close(memfd);
+        return -1;
+    }
+    ep->ch = mmap(NULL, sizeof(struct shm_channel), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, memfd, 0);
+    if (ep->ch == MAP_FAILED) {
+        perror("mmap");
+        ep->ch = NULL;
+        close(memfd);
+        return -1;
+    }
+    memset(ep->ch, 0, sizeof(struct shm_channel));
+    ep->ch->server_cpu = pinned_cpu(0);
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (ep->ch->server_cpu >= 0 &&
+        getsockopt(ep->sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+        pinned_cpu(cred.pid) == ep->ch->server_cpu)
+        ep->spin_max = SHM_SPIN_MIN;
+    ep->req_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ep->resp_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int fds[3] = { memfd, ep->req_efd, ep->resp_efd };
+    if (ep->req_efd < 0 || ep->resp_efd < 0 || send_fds(ep->sock, fds, 3) < 0) {
+        perror("shm_channel_create");
+        close(memfd);
+        shm_channel_close(ep);
+        return -1;
+    }
+    close(memfd);
+    return 0;
+}
+
+int shm_channel_attach(shm_endpoint_t *ep) {
+    init_endpoint(ep);
+    int fds[3];
+    if (recv_fds(ep->sock, fds, 3) < 0) {
+        fprintf(stderr, "shm_channel_attach: no descriptors from server\n");
+        return -1;
+    }
+    ep->req_efd = fds[1];
+    ep->resp_efd = fds[2];
+    ep->ch = mmap(NULL, sizeof(struct shm_channel), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if (ep->ch == MAP_FAILED) {
+        perror("mmap");
+        ep->ch = NULL;
+        shm_channel_close(ep);
+        return -1;
+    }
+    if (ep->ch->server_cpu >= 0 && pinned_cpu(0) == ep->ch->server_cpu)
+        ep->spin_max = SHM_SPIN_MIN;
+    return 0;
+}
+
+void shm_channel_close(shm_endpoint_t *ep) {
+    if (ep->ch) munmap(ep->ch, sizeof(struct shm_channel));
+    if (ep->req_efd >= 0) close(ep->req_efd);
+    if (ep->resp_efd >= 0) close(ep->resp_efd);
+    ep->ch = NULL;
+    ep->req_efd = ep->resp_efd = -1;
+}
+
+int shm_ring_push(struct shm_ring *r, int efd, const struct calcProtocol *msg) {
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    if (tail - head == SHM_RING_SLOTS) return -1;
+    r->slots[tail % SHM_RING_SLOTS] = *msg;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    // Pairs with the fence in shm_ring_pop: either the consumer sees the
+    // new tail, or we see it waiting and wake it.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&r->waiting, memory_order_relaxed)) {
+        uint64_t one = 1;
+        (void)write(efd, &one, sizeof(one));
+    }
+    return 0;
+}
+
+static int try_pop(struct shm_ring *r, struct calcProtocol *msg) {
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head == tail) return 0;
+    *msg = r->slots[head % SHM_RING_SLOTS];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return 1;
+}
+
+int shm_ring_pop(shm_endpoint_t *ep, struct shm_ring *r, int efd, struct calcProtocol *msg) {
+    int limit = ep->spin_max;
+    if (ep->core_sessions && atomic_load_explicit(ep->core_sessions, memory_order_relaxed) > 1)
+        limit = SHM_SPIN_MIN;
+    if (ep->spin > limit) ep->spin = limit;
+    for (;;) {
+        uint64_t start = now_ns();
+        for (int i = 0; i < ep->spin; i++) {
+            if (try_pop(r, msg)) {
+                // Only a spin that ran undisturbed shows that spinning
+                // longer pays off; if we were preempted the peer got to
+                // run because we stopped, not because we waited.
+                uint64_t elapsed = now_ns() - start;
+                if (elapsed > (uint64_t)i * SHM_PAUSE_NS_MAX + SHM_RESCHED_SLACK_NS)
+                    ep->spin = ep->spin / 2 < SHM_SPIN_MIN ? SHM_SPIN_MIN : ep->spin / 2;
+                else if (ep->spin < limit)
+                    ep->spin = ep->spin * 2 > limit ? limit : ep->spin * 2;
+                return 0;
+            }
+            cpu_relax();
+        }
+        atomic_store_explicit(&r->waiting, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (try_pop(r, msg)) {
+            atomic_store_explicit(&r->waiting, 0, memory_order_relaxed);
+            return 0;
+        }
+        struct pollfd pfd[2] = {
+            { efd, POLLIN, 0 },
+            { ep->sock, POLLIN, 0 },
+        };
+        int rv = poll(pfd, 2, -1);
+        atomic_store_explicit(&r->waiting, 0, memory_order_relaxed);
+        if (rv < 0 && errno != EINTR) {
+            perror("poll");
+            return -1;
+        }
+        if (pfd[0].revents & POLLIN) {
+            uint64_t count;
+            (void)read(efd, &count, sizeof(count));
+        }
+        // The peer never writes to the socket after setup, so any
+        // readiness there means it has gone away.
+        if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (try_pop(r, msg)) return 0;
+            return -1;
+        }
+        // Had to sleep; spend less time spinning next round.
+        ep->spin = ep->spin / 2 < SHM_SPIN_MIN ? SHM_SPIN_MIN : ep->spin / 2;
+    }
+}
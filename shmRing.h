@@ -0,0 +1,69 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "common.h"
+
+#define SHM_RING_SLOTS 64
+#define SHM_SPIN_MIN 16
+#define SHM_SPIN_MAX 65536
+// A spin that takes longer than this per poll, plus the slack, must have
+// been preempted and is not evidence that spinning pays off.
+#define SHM_PAUSE_NS_MAX 200
+#define SHM_RESCHED_SLACK_NS 20000
+
+// Single-producer single-consumer ring of calcProtocol frames. head is
+// owned by the consumer, tail by the producer; waiting is raised by a
+// consumer about to sleep on the ring's eventfd.
+struct shm_ring {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Alignas(64) _Atomic uint32_t waiting;
+    _Alignas(64) struct calcProtocol slots[SHM_RING_SLOTS];
+};
+
+// One shared mapping per client: requests flow client to server,
+// responses server to client. server_cpu is the core the handler is
+// pinned to, or -1, so a client pinned to the same core can stop spinning.
+struct shm_channel {
+    int server_cpu;
+    struct shm_ring req;
+    struct shm_ring resp;
+};
+
+typedef struct {
+    struct shm_channel *ch;
+    int req_efd;   // signalled when req gains a frame
+    int resp_efd;  // signalled when resp gains a frame
+    int sock;      // Unix socket to the peer; hangup means it is gone
+    int spin;      // current spin budget, adapted between SHM_SPIN_MIN and spin_max
+    int spin_max;
+    _Atomic int *core_sessions;  // live handlers on this core, or NULL
+} shm_endpoint_t;
+
+// Clamp a requested spin limit to SHM_SPIN_MIN when this process can only
+// run on one CPU, where a spinner just delays the peer it is waiting for.
+// Call before any explicit pinning so a -c choice is not mistaken for it.
+int shm_spin_limit(int requested);
+// Shared per-core session counters for forked handlers; NULL on failure.
+_Atomic int *shm_core_counters(int n);
+
+// Server side: create the mapping and eventfds for ep->sock and pass
+// them to the client with SCM_RIGHTS. Spinning is capped if the client
+// is pinned to the same single core as this process.
+int shm_channel_create(shm_endpoint_t *ep);
+// Client side: receive the descriptors from ep->sock and map the
+// channel, capping spinning if pinned to the server handler's core.
+int shm_channel_attach(shm_endpoint_t *ep);
+void shm_channel_close(shm_endpoint_t *ep);
+
+// Returns -1 if the ring is full.
+int shm_ring_push(struct shm_ring *r, int efd, const struct calcProtocol *msg);
+// Spins for up to ep->spin polls, then blocks on efd. The budget doubles
+// when a spin succeeds without being rescheduled and halves otherwise,
+// and stays at SHM_SPIN_MIN while ep->core_sessions shows a shared core.
+// Returns -1 once the peer has closed ep->sock.
+int shm_ring_pop(shm_endpoint_t *ep, struct shm_ring *r, int efd, struct calcProtocol *msg);
+
+#endif // SHM_RING_H
@@ -0,0 +1,148 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include "common.h"
+#include "shmRing.h"
+
+int setup_unix_server(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long.\n");
+        return -1;
+    }
+    int listenfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    // Only clear away a stale socket, never some other file.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s exists and is not a socket.\n", path);
+            close(listenfd);
+            return -1;
+        }
+        unlink(path);
+    } else if (errno != ENOENT) {
+        perror("lstat");
+        close(listenfd);
+        return -1;
+    }
+    if (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listenfd, 128) < 0) {
+        perror("Failed to bind or listen");
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+void handle_shm_client(int clientfd, int spin_max, _Atomic int *core_sessions) {
+    shm_endpoint_t ep;
+    memset(&ep, 0, sizeof(ep));
+    ep.sock = clientfd;
+    ep.spin_max = spin_max;
+    ep.core_sessions = core_sessions;
+    if (shm_channel_create(&ep) < 0) return;
+    struct calcProtocol req, resp;
+    while (shm_ring_pop(&ep, &ep.ch->req, ep.req_efd, &req) == 0) {
+        if (evaluate_frame(&req, &resp) != 0) {
+            // Same frame back with type 2 marks a rejected request.
+            resp = req;
+            resp.type = htons(2);
+        }
+        if (shm_ring_push(&ep.ch->resp, ep.resp_efd, &resp) < 0) {
+            fprintf(stderr, "Response ring full, dropping client\n");
+            break;
+        }
+    }
+    shm_channel_close(&ep);
+}
+
+int main(int argc, char *argv[]) {
+    int cpus[MAX_CPUS], ncpus = 0, spin_max = SHM_SPIN_MAX, opt;
+    while ((opt = getopt(argc, argv, "c:s:")) != -1) {
+        switch (opt) {
+            case 'c':
+                ncpus = parse_cpu_list(optarg, cpus, MAX_CPUS);
+                if (ncpus < 0) {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's': spin_max = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-c cpu_list] [-s max_spin] <socket path>\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: %s [-c cpu_list] [-s max_spin] <socket path>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *path = argv[optind];
+    spin_max = shm_spin_limit(spin_max);
+    // Live handlers per listed core. Once a core holds more than one,
+    // its handlers stop spinning instead of starving each other.
+    _Atomic int *core_sessions = NULL;
+    if (ncpus > 0 && !(core_sessions = shm_core_counters(ncpus))) return EXIT_FAILURE;
+    int listenfd = setup_unix_server(path);
+    if (listenfd < 0) return EXIT_FAILURE;
+    printf("SHM server listening on %s\n", path);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGCHLD, &sa, NULL);
+    unsigned long sessions = 0;
+    while (1) {
+        int clientfd = accept(listenfd, NULL, NULL);
+        if (clientfd < 0) {
+            perror("accept");
+            continue;
+        }
+        // Handlers take cores from the list in turn. Repeated entries for
+        // the same CPU share one counter.
+        int cpu = -1;
+        _Atomic int *load = NULL;
+        if (ncpus > 0) {
+            cpu = cpus[sessions++ % ncpus];
+            int slot = 0;
+            while (cpus[slot] != cpu) slot++;
+            load = &core_sessions[slot];
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            close(clientfd);
+            continue;
+        } else if (pid == 0) {
+            close(listenfd);
+            // Pin before the rings are first touched so they land on the
+            // handler's NUMA node.
+            if (cpu >= 0) pin_to_cpu(cpu);
+            if (load) atomic_fetch_add(load, 1);
+            handle_shm_client(clientfd, spin_max, load);
+            if (load) atomic_fetch_sub(load, 1);
+            close(clientfd);
+            exit(EXIT_SUCCESS);
+        } else {
+            close(clientfd);
+        }
+    }
+    close(listenfd);
+    unlink(path);
+    return 0;
+}
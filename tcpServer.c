@@ -9,8 +9,11 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdint.h>
 #include <time.h>
+#include "common.h"
 
 #ifndef HAVE_STRNLEN
 size_t strnlen(const char *s, size_t maxlen) {
@@ -40,20 +43,7 @@ char *strndup(const char *s, size_t n) {
 #endif
 
 #define BUFFER_SIZE 1024
-
-struct __attribute__((__packed__)) calcProtocol {
-    uint16_t type;
-    uint16_t major_version;
-    uint16_t minor_version;
-    uint32_t id;
-    uint32_t arith;
-    int32_t inValue1;
-    int32_t inValue2;
-    int32_t inResult;
-    double flValue1;
-    double flValue2;
-    double flResult;
-};
+#define DEFAULT_BACKLOG 1024
 
 int client_socket = -1;
 
@@ -80,7 +70,11 @@ int parse_host_port(const char *input, char **host, char **port) {
     return 0;
 }
 
-int setup_tcp_server(const char *host, const char *port) {
+// backlog is the listen() queue length; fastopen_qlen > 0 enables TCP Fast
+// Open with that many pending SYN-data requests; defer_secs > 0 sets
+// TCP_DEFER_ACCEPT so accept() only returns once the client has sent data.
+int setup_tcp_server(const char *host, const char *port,
+                     int backlog, int fastopen_qlen, int defer_secs) {
     struct addrinfo hints, *res, *p;
     int listenfd = -1, yes = 1;
     memset(&hints, 0, sizeof(hints));
@@ -103,7 +97,17 @@ int setup_tcp_server(const char *host, const char *port) {
             listenfd = -1;
             continue;
         }
-        if (listen(listenfd, 10) < 0) {
+#ifdef TCP_DEFER_ACCEPT
+        if (defer_secs > 0 &&
+            setsockopt(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_secs, sizeof(int)) < 0)
+            perror("setsockopt TCP_DEFER_ACCEPT");
+#endif
+#ifdef TCP_FASTOPEN
+        if (fastopen_qlen > 0 &&
+            setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN, &fastopen_qlen, sizeof(int)) < 0)
+            perror("setsockopt TCP_FASTOPEN");
+#endif
+        if (listen(listenfd, backlog) < 0) {
             close(listenfd);
             listenfd = -1;
             continue;
@@ -117,32 +121,6 @@ int setup_tcp_server(const char *host, const char *port) {
     return listenfd;
 }
 
-int32_t do_int_op(uint32_t arith, int32_t v1, int32_t v2, int *err) {
-    *err = 0;
-    switch (arith) {
-        case 1: return v1 + v2;
-        case 2: return v1 - v2;
-        case 3: return v1 * v2;
-        case 4:
-            if (v2 == 0) { *err = 1; return 0; }
-            return v1 / v2;
-        default: *err = 1; return 0;
-    }
-}
-
-double do_float_op(uint32_t arith, double v1, double v2, int *err) {
-    *err = 0;
-    switch (arith) {
-        case 5: return v1 + v2;
-        case 6: return v1 - v2;
-        case 7: return v1 * v2;
-        case 8:
-            if (v2 == 0.0) { *err = 1; return 0.0; }
-            return v1 / v2;
-        default: *err = 1; return 0.0;
-    }
-}
-
 void generate_int_task(int *op, int *v1, int *v2) {
     *op = (rand() % 4) + 1;
     *v1 = (rand() % 100) + 1;
@@ -206,35 +184,7 @@ void handle_client_protocol(int clientfd) {
     if (n == sizeof(struct calcProtocol)) {
         struct calcProtocol req, resp;
         memcpy(&req, buffer, sizeof(req));
-        req.type = ntohs(req.type);
-        req.major_version = ntohs(req.major_version);
-        req.minor_version = ntohs(req.minor_version);
-        req.id = ntohl(req.id);
-        req.arith = ntohl(req.arith);
-        req.inValue1 = ntohl(req.inValue1);
-        req.inValue2 = ntohl(req.inValue2);
-        req.inResult = ntohl(req.inResult);
-        memset(&resp, 0, sizeof(resp));
-        resp.type = htons(1);
-        resp.major_version = htons(1);
-        resp.minor_version = htons(1);
-        resp.id = htonl(req.id);
-        resp.arith = htonl(req.arith);
-        resp.inValue1 = htonl(req.inValue1);
-        resp.inValue2 = htonl(req.inValue2);
-        int err = 0;
-        if (req.arith >= 1 && req.arith <= 4) {
-            int32_t result = do_int_op(req.arith, req.inValue1, req.inValue2, &err);
-            resp.inResult = htonl(result);
-            resp.flResult = 0.0;
-        } else if (req.arith >= 5 && req.arith <= 8) {
-            double result = do_float_op(req.arith, req.flValue1, req.flValue2, &err);
-            resp.inResult = 0;
-            resp.flResult = result;
-        } else {
-            err = 1;
-        }
-        if (err) {
+        if (evaluate_frame(&req, &resp) != 0) {
             (void)write(clientfd, "ERROR TO\n", 9);
         } else {
             send(clientfd, &resp, sizeof(resp), 0);
@@ -245,17 +195,65 @@ void handle_client_protocol(int clientfd) {
     (void)write(clientfd, "ERROR TO\n", 9);
 }
 
+// Server-side Fast Open needs the 0x2 flag in net.ipv4.tcp_fastopen;
+// without it the kernel accepts the option and quietly falls back to a
+// normal handshake.
+void check_fastopen_sysctl(void) {
+    FILE *f = fopen("/proc/sys/net/ipv4/tcp_fastopen", "r");
+    if (!f) return;
+    int mode = 0;
+    if (fscanf(f, "%i", &mode) == 1 && !(mode & 0x2))
+        fprintf(stderr, "Warning: net.ipv4.tcp_fastopen=%d lacks 0x2, "
+                "TCP Fast Open will fall back to a normal handshake\n", mode);
+    fclose(f);
+}
+
+// Parse a strictly positive integer option; returns -1 otherwise.
+int parse_positive(const char *arg) {
+    char *end;
+    errno = 0;
+    long v = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno != 0 || v <= 0 || v > INT32_MAX)
+        return -1;
+    return (int)v;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-c cpu_list] [-l backlog] [-f fastopen_qlen] [-d defer_secs] <host:port>\n", prog);
+    exit(EXIT_FAILURE);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <host:port>\n", argv[0]);
-        return EXIT_FAILURE;
+    int cpus[MAX_CPUS], ncpus = 0, backlog = DEFAULT_BACKLOG, fastopen_qlen = 0, defer_secs = 0, opt;
+    while ((opt = getopt(argc, argv, "c:l:f:d:")) != -1) {
+        switch (opt) {
+            case 'c':
+                ncpus = parse_cpu_list(optarg, cpus, MAX_CPUS);
+                if (ncpus < 0) {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'l':
+                if ((backlog = parse_positive(optarg)) < 0) usage(argv[0]);
+                break;
+            case 'f':
+                if ((fastopen_qlen = parse_positive(optarg)) < 0) usage(argv[0]);
+                break;
+            case 'd':
+                if ((defer_secs = parse_positive(optarg)) < 0) usage(argv[0]);
+                break;
+            default: usage(argv[0]);
+        }
     }
+    if (argc - optind != 1) usage(argv[0]);
     char *host = NULL, *port = NULL;
-    if (parse_host_port(argv[1], &host, &port) != 0) {
+    if (parse_host_port(argv[optind], &host, &port) != 0) {
         fprintf(stderr, "Invalid argument format. Use host:port.\n");
         return EXIT_FAILURE;
     }
-    int listenfd = setup_tcp_server(host, port);
+    if (fastopen_qlen > 0) check_fastopen_sysctl();
+    int listenfd = setup_tcp_server(host, port, backlog, fastopen_qlen, defer_secs);
     if (listenfd < 0) {
         free(host); free(port);
         return EXIT_FAILURE;
@@ -265,6 +263,10 @@ int main(int argc, char *argv[]) {
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = alarm_handler;
     sigaction(SIGALRM, &sa, NULL);
+    // Session handlers are never waited for; let the kernel reap them.
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGCHLD, &sa, NULL);
+    unsigned long sessions = 0;
     while (1) {
         struct sockaddr_storage client_addr;
         socklen_t addr_size = sizeof(client_addr);
@@ -273,6 +275,8 @@ int main(int argc, char *argv[]) {
             perror("accept");
             continue;
         }
+        // Each session handler gets the next core in the list.
+        int cpu = ncpus > 0 ? cpus[sessions++ % ncpus] : -1;
         pid_t pid = fork();
         if (pid < 0) {
             perror("fork");
@@ -280,6 +284,7 @@ int main(int argc, char *argv[]) {
             continue;
         } else if (pid == 0) {
             close(listenfd);
+            if (cpu >= 0) pin_to_cpu(cpu);
             client_socket = clientfd;
             handle_client_protocol(clientfd);
             close(clientfd);
@@ -10,6 +10,7 @@
 #include <sys/select.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include "common.h"
 
 #ifndef HAVE_STRNLEN
 size_t strnlen(const char *s, size_t maxlen) {
@@ -41,20 +42,6 @@ char *strndup(const char *s, size_t n) {
 #define MAX_CLIENTS 100
 #define BUFFER_SIZE 1024
 
-struct __attribute__((__packed__)) calcProtocol {
-    uint16_t type;
-    uint16_t major_version;
-    uint16_t minor_version;
-    uint32_t id;
-    uint32_t arith;
-    int32_t inValue1;
-    int32_t inValue2;
-    int32_t inResult;
-    double flValue1;
-    double flValue2;
-    double flResult;
-};
-
 typedef struct {
     struct sockaddr_storage addr;
     socklen_t addr_len;
@@ -138,32 +125,6 @@ int setup_udp_socket(const char *host, const char *port) {
     return sockfd;
 }
 
-int32_t do_int_op(uint32_t arith, int32_t v1, int32_t v2, int *err) {
-    *err = 0;
-    switch (arith) {
-        case 1: return v1 + v2;
-        case 2: return v1 - v2;
-        case 3: return v1 * v2;
-        case 4:
-            if (v2 == 0) { *err = 1; return 0; }
-            return v1 / v2;
-        default: *err = 1; return 0;
-    }
-}
-
-double do_float_op(uint32_t arith, double v1, double v2, int *err) {
-    *err = 0;
-    switch (arith) {
-        case 5: return v1 + v2;
-        case 6: return v1 - v2;
-        case 7: return v1 * v2;
-        case 8:
-            if (v2 == 0.0) { *err = 1; return 0.0; }
-            return v1 / v2;
-        default: *err = 1; return 0.0;
-    }
-}
-
 void generate_int_task(struct calcProtocol *task) {
     int op = (rand() % 4) + 1;
     int v1 = (rand() % 100) + 1;
@@ -214,148 +175,107 @@ void generate_float_task(struct calcProtocol *task) {
     task->flResult = 0.0;
 }
 
+static void usage(void) {
+    fprintf(stderr, "Usage: udpServer [-c cpu] [-b busy_poll_usec] <IPv4/IPv6/DNS>:<Port>\n");
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: udpServer <IPv4/IPv6/DNS>:<Port>\n");
-        exit(1);
+    int cpu = -1, busy_usec = 0, opt;
+    while ((opt = getopt(argc, argv, "c:b:")) != -1) {
+        switch (opt) {
+            case 'c':
+                if (parse_cpu_list(optarg, &cpu, 1) != 1) {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'b': busy_usec = atoi(optarg); break;
+            default: usage();
+        }
     }
+    if (argc - optind != 1) usage();
     char *host = NULL, *port = NULL;
-    char *colon = strchr(argv[1], ':');
+    char *colon = strchr(argv[optind], ':');
     if (!colon) {
         fprintf(stderr, "Invalid argument format, expected <host>:<port>\n");
         exit(1);
     }
-    host = strndup(argv[1], colon - argv[1]);
+    host = strndup(argv[optind], colon - argv[optind]);
     port = strdup(colon + 1);
     srand(time(NULL));
+    // Pin before the session table is first written so its pages are
+    // allocated on the local NUMA node.
+    if (cpu >= 0 && pin_to_cpu(cpu) < 0) exit(1);
     memset(clients, 0, sizeof(clients));
     int sockfd = setup_udp_socket(host, port);
     if (sockfd < 0) {
         perror("Failed to set up UDP socket");
         exit(1);
     }
+    enable_busy_poll(sockfd, busy_usec);
     printf("UDP server listening on %s:%s\n", host, port);
     fd_set read_fds;
     struct timeval tv;
     while (1) {
-        FD_ZERO(&read_fds);
-        FD_SET(sockfd, &read_fds);
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        int rv = select(sockfd + 1, &read_fds, NULL, NULL, &tv);
-        if (rv < 0) {
-            perror("select");
-            continue;
-        } else if (rv == 0) {
-            time_t now = time(NULL);
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                if (clients[i].occupied && clients[i].expecting_response &&
-                    now - clients[i].last_active > 10) {
-                    printf("Client timed out, removing\n");
-                    remove_client(i);
+        char buf[BUFFER_SIZE];
+        struct sockaddr_storage client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        ssize_t n = -1;
+        // Spin-then-block: poll the socket for a short window before
+        // paying for a select() sleep and wakeup.
+        if (busy_usec > 0)
+            n = spin_recvfrom(sockfd, buf, sizeof(buf),
+                              (struct sockaddr *)&client_addr, &addr_len, busy_usec);
+        if (n < 0) {
+            FD_ZERO(&read_fds);
+            FD_SET(sockfd, &read_fds);
+            tv.tv_sec = 1;
+            tv.tv_usec = 0;
+            int rv = select(sockfd + 1, &read_fds, NULL, NULL, &tv);
+            if (rv < 0) {
+                perror("select");
+                continue;
+            } else if (rv == 0) {
+                time_t now = time(NULL);
+                for (int i = 0; i < MAX_CLIENTS; i++) {
+                    if (clients[i].occupied && clients[i].expecting_response &&
+                        now - clients[i].last_active > 10) {
+                        printf("Client timed out, removing\n");
+                        remove_client(i);
+                    }
                 }
+                continue;
             }
-            continue;
-        }
-        if (FD_ISSET(sockfd, &read_fds)) {
-            char buf[BUFFER_SIZE];
-            struct sockaddr_storage client_addr;
-            socklen_t addr_len = sizeof(client_addr);
-            ssize_t n = recvfrom(sockfd, buf, sizeof(buf), 0,
-                                 (struct sockaddr *)&client_addr, &addr_len);
+            if (!FD_ISSET(sockfd, &read_fds)) continue;
+            addr_len = sizeof(client_addr);
+            n = recvfrom(sockfd, buf, sizeof(buf), 0,
+                         (struct sockaddr *)&client_addr, &addr_len);
             if (n < 0) {
                 perror("recvfrom");
                 continue;
             }
-            int idx = find_client(&client_addr, addr_len);
-            time_t now = time(NULL);
-            if (n == sizeof(struct calcProtocol)) {
-                struct calcProtocol *msg = (struct calcProtocol *)buf;
-                if (idx == -1) {
+        }
+        int idx = find_client(&client_addr, addr_len);
+        time_t now = time(NULL);
+        if (n == sizeof(struct calcProtocol)) {
+            struct calcProtocol *msg = (struct calcProtocol *)buf;
+            // A hello from a known address restarts its session rather
+            // than being graded as the answer to the previous task.
+            if (idx == -1 || ntohs(msg->type) == CALC_MSG_HELLO) {
+                if (idx == -1)
                     idx = add_client(&client_addr, addr_len);
-                    if (idx == -1) {
-                        fprintf(stderr, "Too many clients\n");
-                        continue;
-                    }
-                    if ((rand() % 2) == 0)
-                        generate_int_task(&clients[idx].task);
-                    else
-                        generate_float_task(&clients[idx].task);
-                    clients[idx].last_active = now;
-                    clients[idx].expecting_response = 1;
-                    sendto(sockfd, &clients[idx].task, sizeof(struct calcProtocol), 0,
-                           (struct sockaddr *)&client_addr, addr_len);
-                    continue;
-                }
-                clients[idx].last_active = now;
-                if (!clients[idx].expecting_response) {
-                    const char *msg = "ERROR: response rejected (late or unexpected)\n";
-                    sendto(sockfd, msg, strlen(msg), 0,
-                           (struct sockaddr *)&client_addr, addr_len);
-                    continue;
-                }
-                int err = 0;
-                int32_t correct = 0;
-                double fcorrect = 0.0;
-                uint32_t arith = ntohl(msg->arith);
-                if (arith >= 1 && arith <= 4) {
-                    int32_t v1 = ntohl(msg->inValue1);
-                    int32_t v2 = ntohl(msg->inValue2);
-                    correct = do_int_op(arith, v1, v2, &err);
-                    int32_t answer = ntohl(msg->inResult);
-                    const char *res_msg = (!err && answer == correct) ? "RESULT: correct\n" : "RESULT: incorrect\n";
-                    sendto(sockfd, res_msg, strlen(res_msg), 0,
-                           (struct sockaddr *)&client_addr, addr_len);
-                } else if (arith >= 5 && arith <= 8) {
-                    double v1 = msg->flValue1;
-                    double v2 = msg->flValue2;
-                    fcorrect = do_float_op(arith, v1, v2, &err);
-                    double answer = msg->flResult;
-                    const char *res_msg = (!err && answer == fcorrect) ? "RESULT: correct\n" : "RESULT: incorrect\n";
-                    sendto(sockfd, res_msg, strlen(res_msg), 0,
-                           (struct sockaddr *)&client_addr, addr_len);
-                } else {
-                    const char *msg = "ERROR: invalid operation\n";
-                    sendto(sockfd, msg, strlen(msg), 0,
-                           (struct sockaddr *)&client_addr, addr_len);
-                }
-                clients[idx].expecting_response = 0;
-                remove_client(idx);
-                continue;
-            }
-            buf[n] = '\0';
-            if (idx == -1) {
-                idx = add_client(&client_addr, addr_len);
                 if (idx == -1) {
                     fprintf(stderr, "Too many clients\n");
                     continue;
                 }
-                int op, v1, v2;
-                op = (rand() % 4) + 1;
-                v1 = (rand() % 100) + 1;
-                if (op == 4) {
-                    do {
-                        v2 = (rand() % 99) + 1;
-                    } while (v2 == 0);
-                } else {
-                    v2 = (rand() % 100) + 1;
-                }
-                clients[idx].task.arith = op;
-                clients[idx].task.inValue1 = v1;
-                clients[idx].task.inValue2 = v2;
+                if ((rand() % 2) == 0)
+                    generate_int_task(&clients[idx].task);
+                else
+                    generate_float_task(&clients[idx].task);
                 clients[idx].last_active = now;
                 clients[idx].expecting_response = 1;
-                char opchar;
-                switch (op) {
-                    case 1: opchar = '+'; break;
-                    case 2: opchar = '-'; break;
-                    case 3: opchar = '*'; break;
-                    case 4: opchar = '/'; break;
-                    default: opchar = '?'; break;
-                }
-                char task_msg[100];
-                snprintf(task_msg, sizeof(task_msg), "%d %c %d\n", v1, opchar, v2);
-                sendto(sockfd, task_msg, strlen(task_msg), 0,
+                sendto(sockfd, &clients[idx].task, sizeof(struct calcProtocol), 0,
                        (struct sockaddr *)&client_addr, addr_len);
                 continue;
             }
@@ -366,14 +286,85 @@ int main(int argc, char *argv[]) {
                        (struct sockaddr *)&client_addr, addr_len);
                 continue;
             }
-            int answer = atoi(buf);
-            int correct = do_int_op(clients[idx].task.arith, clients[idx].task.inValue1, clients[idx].task.inValue2, &(int){0});
-            const char *res_msg = (answer == correct) ? "RESULT: correct\n" : "RESULT: incorrect\n";
-            sendto(sockfd, res_msg, strlen(res_msg), 0,
-                   (struct sockaddr *)&client_addr, addr_len);
+            int err = 0;
+            int32_t correct = 0;
+            double fcorrect = 0.0;
+            uint32_t arith = ntohl(msg->arith);
+            if (arith >= 1 && arith <= 4) {
+                int32_t v1 = ntohl(msg->inValue1);
+                int32_t v2 = ntohl(msg->inValue2);
+                correct = do_int_op(arith, v1, v2, &err);
+                int32_t answer = ntohl(msg->inResult);
+                const char *res_msg = (!err && answer == correct) ? "RESULT: correct\n" : "RESULT: incorrect\n";
+                sendto(sockfd, res_msg, strlen(res_msg), 0,
+                       (struct sockaddr *)&client_addr, addr_len);
+            } else if (arith >= 5 && arith <= 8) {
+                double v1 = msg->flValue1;
+                double v2 = msg->flValue2;
+                fcorrect = do_float_op(arith, v1, v2, &err);
+                double answer = msg->flResult;
+                const char *res_msg = (!err && answer == fcorrect) ? "RESULT: correct\n" : "RESULT: incorrect\n";
+                sendto(sockfd, res_msg, strlen(res_msg), 0,
+                       (struct sockaddr *)&client_addr, addr_len);
+            } else {
+                const char *msg = "ERROR: invalid operation\n";
+                sendto(sockfd, msg, strlen(msg), 0,
+                       (struct sockaddr *)&client_addr, addr_len);
+            }
             clients[idx].expecting_response = 0;
             remove_client(idx);
+            continue;
+        }
+        buf[n] = '\0';
+        if (idx == -1) {
+            idx = add_client(&client_addr, addr_len);
+            if (idx == -1) {
+                fprintf(stderr, "Too many clients\n");
+                continue;
+            }
+            int op, v1, v2;
+            op = (rand() % 4) + 1;
+            v1 = (rand() % 100) + 1;
+            if (op == 4) {
+                do {
+                    v2 = (rand() % 99) + 1;
+                } while (v2 == 0);
+            } else {
+                v2 = (rand() % 100) + 1;
+            }
+            clients[idx].task.arith = op;
+            clients[idx].task.inValue1 = v1;
+            clients[idx].task.inValue2 = v2;
+            clients[idx].last_active = now;
+            clients[idx].expecting_response = 1;
+            char opchar;
+            switch (op) {
+                case 1: opchar = '+'; break;
+                case 2: opchar = '-'; break;
+                case 3: opchar = '*'; break;
+                case 4: opchar = '/'; break;
+                default: opchar = '?'; break;
+            }
+            char task_msg[100];
+            snprintf(task_msg, sizeof(task_msg), "%d %c %d\n", v1, opchar, v2);
+            sendto(sockfd, task_msg, strlen(task_msg), 0,
+                   (struct sockaddr *)&client_addr, addr_len);
+            continue;
+        }
+        clients[idx].last_active = now;
+        if (!clients[idx].expecting_response) {
+            const char *msg = "ERROR: response rejected (late or unexpected)\n";
+            sendto(sockfd, msg, strlen(msg), 0,
+                   (struct sockaddr *)&client_addr, addr_len);
+            continue;
         }
+        int answer = atoi(buf);
+        int correct = do_int_op(clients[idx].task.arith, clients[idx].task.inValue1, clients[idx].task.inValue2, &(int){0});
+        const char *res_msg = (answer == correct) ? "RESULT: correct\n" : "RESULT: incorrect\n";
+        sendto(sockfd, res_msg, strlen(res_msg), 0,
+               (struct sockaddr *)&client_addr, addr_len);
+        clients[idx].expecting_response = 0;
+        remove_client(idx);
     }
     free(host);
     free(port);